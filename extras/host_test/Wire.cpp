@@ -0,0 +1,122 @@
+//============================================================================
+// Name        : Wire.cpp
+// Description : Host TwoWire mock, see Wire.h.
+//============================================================================
+
+#include "Wire.h"
+
+TwoWire Wire;
+
+    TwoWire::TwoWire(){
+        this->interleaved = 0;
+        this->clock = 100000;
+        this->add = 0;
+        this->reg = 0;
+        this->phase = 0;
+        this->rxPos = 0;
+        this->dataBytes = 0;
+        this->reading = 0;
+        this->mem[(0x57 << 16) | 0x14] = 0xFF;//MEM_SIZE_L
+        this->mem[(0x57 << 16) | 0x15] = 0x07;//MEM_SIZE_H, 64K part
+        this->mem[(0x57 << 16) | 0x17] = 0x26;//IC_REF
+        this->mem[(0x57 << 16) | 0x05] = 0xFF;//ENDA1..3 default to the end of memory
+        this->mem[(0x57 << 16) | 0x07] = 0xFF;
+        this->mem[(0x57 << 16) | 0x09] = 0xFF;
+    }
+
+    bool TwoWire::begin(){
+        return 1;
+    }
+
+    void TwoWire::setClock(uint32_t hz){
+        this->clock = hz;
+    }
+
+    //Another thread touching the bus mid-transaction means the library let
+    //two transactions interleave
+    void TwoWire::check(){
+        if(this->owner != std::this_thread::get_id()){this->interleaved++;}
+    }
+
+    //ENDA1 <= ENDA2 <= ENDA3 must hold after every single ENDA write
+    bool TwoWire::endaValid(uint16_t reg, uint8_t dat){
+        if((reg != 0x05) && (reg != 0x07) && (reg != 0x09)){return true;}
+        uint8_t enda[3];
+        for(uint8_t i = 0; i < 3; i++){
+            uint16_t r = 0x05 + 2 * i;
+            enda[i] = (r == reg) ? dat : this->mem[(0x57 << 16) | r];
+        }
+        return (enda[0] <= enda[1]) && (enda[1] <= enda[2]);
+    }
+
+    void TwoWire::beginTransmission(uint8_t add){
+        std::lock_guard<std::mutex> guard(this->state);
+        if(this->owner != std::thread::id()){this->interleaved++;}
+        this->owner = std::this_thread::get_id();
+        this->add = add;
+        this->phase = 0;
+    }
+
+    size_t TwoWire::write(uint8_t dat){
+        {
+            std::lock_guard<std::mutex> guard(this->state);
+            check();
+            if(this->phase == 0){
+                this->reg = dat << 8;
+                this->phase = 1;
+            }
+            else if(this->phase == 1){
+                this->reg |= dat;
+                this->phase = 2;
+                this->log.push_back(this->reg);
+            }
+            else{
+                this->dataBytes++;
+                if((this->add != 0x57) || endaValid(this->reg, dat)){
+                    this->mem[((uint32_t)this->add << 16) | this->reg] = dat;
+                }
+                this->reg++;
+            }
+        }
+        std::this_thread::yield();//Widen the window for races
+        return 1;
+    }
+
+    //A write ends at its endTransmission. A read only sets the register there
+    //and ends at the endTransmission that follows requestFrom.
+    uint8_t TwoWire::endTransmission(bool stop){
+        std::lock_guard<std::mutex> guard(this->state);
+        check();
+        if(stop && (this->reading || this->dataBytes)){
+            this->owner = std::thread::id();
+            this->reading = 0;
+            this->dataBytes = 0;
+        }
+        return 0;
+    }
+
+    uint8_t TwoWire::requestFrom(uint8_t add, uint8_t len){
+        std::lock_guard<std::mutex> guard(this->state);
+        check();
+        this->reading = 1;
+        this->rx.clear();
+        this->rxPos = 0;
+        for(uint8_t i = 0; i < len; i++){
+            this->rx.push_back(this->mem[((uint32_t)add << 16) | (uint16_t)(this->reg + i)]);
+        }
+        return len;
+    }
+
+    int TwoWire::available(){
+        return this->rx.size() - this->rxPos;
+    }
+
+    int TwoWire::read(){
+        std::lock_guard<std::mutex> guard(this->state);
+        check();
+        return (this->rxPos < this->rx.size()) ? this->rx[this->rxPos++] : -1;
+    }
+
+    int TwoWire::peek(){
+        return (this->rxPos < this->rx.size()) ? this->rx[this->rxPos] : -1;
+    }
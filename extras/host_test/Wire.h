@@ -0,0 +1,52 @@
+//============================================================================
+// Name        : Wire.h
+// Description : Host TwoWire mock backed by a simulated ST25DV register map.
+//               Records the register of every transaction and counts calls
+//               made by one thread while another thread's transaction is open.
+//               Like the tag, it ignores ENDA writes that would break
+//               ENDA1 <= ENDA2 <= ENDA3.
+//============================================================================
+
+#ifndef Wire_h
+#define Wire_h
+
+#include "arduino.h"
+#include <map>
+#include <mutex>
+#include <vector>
+
+class TwoWire : public Stream
+{
+    public:
+        TwoWire(void);
+        bool begin();
+        void setClock(uint32_t hz);
+        void beginTransmission(uint8_t add);
+        size_t write(uint8_t dat);
+        uint8_t endTransmission(bool stop = true);
+        uint8_t requestFrom(uint8_t add, uint8_t len);
+        int available();
+        int read();
+        int peek();
+
+        std::map<uint32_t, uint8_t> mem;//(address << 16) | register
+        std::vector<uint16_t> log;//Register of each transaction, in bus order
+        uint32_t interleaved;
+        uint32_t clock;
+
+    private:
+        void check();
+        bool endaValid(uint16_t reg, uint8_t dat);
+        std::mutex state;
+        std::thread::id owner;
+        uint8_t add;
+        uint16_t reg;
+        uint8_t phase;
+        uint16_t dataBytes;
+        bool reading;
+        std::vector<uint8_t> rx;
+        size_t rxPos;
+};
+
+extern TwoWire Wire;
+#endif
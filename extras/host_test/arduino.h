@@ -0,0 +1,59 @@
+//============================================================================
+// Name        : arduino.h
+// Description : Minimal Arduino core shim so the library builds on a host for
+//               the tests in this directory. Only what the library uses.
+//============================================================================
+
+#ifndef arduino_h
+#define arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using std::min;
+
+inline unsigned long micros(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long millis(){
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms){
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class Print
+{
+    public:
+        virtual ~Print(){}
+        virtual size_t write(uint8_t dat) = 0;
+        virtual size_t write(const uint8_t* dat, size_t len){
+            size_t count = 0;
+            while(len--){count += write(*dat++);}
+            return count;
+        }
+};
+
+class Stream : public Print
+{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        size_t readBytes(uint8_t* dat, size_t len){
+            size_t count = 0;
+            while(count < len){
+                int c = read();
+                if(c < 0){break;}
+                dat[count++] = c;
+            }
+            return count;
+        }
+};
+#endif
@@ -0,0 +1,170 @@
+//============================================================================
+// Name        : test_compress.cpp
+// Description : Host tests for the compressed record codecs and functions:
+//               codec round-trips, corrupt delta input, records written to and
+//               read back from the mock tag, and records that do not fit.
+//============================================================================
+
+#include "ST25DV.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(cond, ...) do{if(!(cond)){printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++;}}while(0)
+
+static std::vector<uint8_t> lzEncode(const std::vector<uint8_t> &in){
+    std::vector<uint8_t> out;
+    uint8_t encoded[ST25DV_LZ_MAX_LITERALS + 1];
+    uint16_t pos = 0;
+    while(pos < in.size()){
+        uint8_t n = ST25DVLZEncoder::next(in.data(), in.size(), pos, encoded);
+        out.insert(out.end(), encoded, encoded + n);
+    }
+    return out;
+}
+
+static std::vector<uint8_t> lzDecode(const std::vector<uint8_t> &in){
+    std::vector<uint8_t> out;
+    ST25DVLZDecoder decoder;
+    for(size_t i = 0; i < in.size(); i++){
+        decoder.push(in[i]);
+        while(decoder.available()){out.push_back(decoder.read());}
+    }
+    return out;
+}
+
+static std::vector<int32_t> deltaRoundTrip(const std::vector<int32_t> &in, size_t &size){
+    std::vector<uint8_t> encoded;
+    uint8_t buffer[5];
+    ST25DVDeltaEncoder encoder;
+    for(size_t i = 0; i < in.size(); i++){
+        uint8_t n = encoder.push(in[i], buffer);
+        encoded.insert(encoded.end(), buffer, buffer + n);
+    }
+    size = encoded.size();
+    std::vector<int32_t> out;
+    ST25DVDeltaDecoder decoder;
+    int32_t sample;
+    for(size_t i = 0; i < encoded.size(); i++){
+        if(decoder.push(encoded[i], sample)){out.push_back(sample);}
+    }
+    return out;
+}
+
+//Random, low entropy (few distinct values) and run-heavy inputs
+static std::vector<uint8_t> bytes(uint8_t kind, uint16_t len){
+    std::vector<uint8_t> out;
+    while(out.size() < len){
+        if(kind == 0){out.push_back(rand());}
+        else if(kind == 1){out.push_back("ST25"[rand() % 4]);}
+        else{out.insert(out.end(), 1 + rand() % 200, rand());}
+    }
+    out.resize(len);
+    return out;
+}
+
+static std::vector<int32_t> samples(uint8_t kind, uint16_t count){
+    std::vector<int32_t> out;
+    int32_t value = 20000;
+    for(uint16_t i = 0; i < count; i++){
+        if(kind == 0){value = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());}
+        else if(kind == 1){value += rand() % 7 - 3;}
+        else if((i % 50) == 0){value = rand() % 1000 - 500;}
+        out.push_back(value);
+    }
+    out.push_back(INT32_MIN);//Largest deltas either way
+    out.push_back(INT32_MAX);
+    return out;
+}
+
+static void testCodecs(){
+    for(uint8_t kind = 0; kind < 3; kind++){
+        for(uint16_t len = 0; len < 2000; len += 97){
+            std::vector<uint8_t> in = bytes(kind, len);
+            std::vector<uint8_t> encoded = lzEncode(in);
+            EXPECT(lzDecode(encoded) == in, "LZ round-trip failed, kind %u, %u bytes", kind, len);
+            if(kind == 2 && len > 500){
+                EXPECT(encoded.size() < len / 4, "runs compressed to %u of %u bytes", (unsigned)encoded.size(), len);
+            }
+        }
+        size_t size;
+        std::vector<int32_t> in = samples(kind, 500);
+        EXPECT(deltaRoundTrip(in, size) == in, "delta round-trip failed, kind %u", kind);
+        if(kind == 1){
+            EXPECT(size < in.size() + 20, "slow series took %u bytes for %u samples", (unsigned)size, (unsigned)in.size());
+        }
+    }
+}
+
+static void testDeltaCorrupt(){
+    for(uint16_t run = 1; run <= 64; run++){
+        ST25DVDeltaDecoder decoder;
+        int32_t sample;
+        bool early = false;
+        for(uint16_t i = 0; i < run; i++){
+            early |= decoder.push(0xFF, sample);
+        }
+        EXPECT(!early, "a run of %u 0xFF bytes produced a sample", run);
+        EXPECT(decoder.push(0x00, sample), "no sample after a run of %u 0xFF bytes", run);
+    }
+    //Every fifth continuation byte starts over, the next varint decodes cleanly
+    ST25DVDeltaDecoder decoder;
+    int32_t sample = 0;
+    for(uint16_t i = 0; i < 100; i++){decoder.push(0xFF, sample);}
+    bool complete = decoder.push(0x02, sample);
+    EXPECT(complete && (sample == 1), "decoded %d after the run, expected 1", (int)sample);
+}
+
+static void testRecords(ST25DV &tag){
+    std::vector<int32_t> series = samples(1, 300);
+    uint16_t size = tag.writeSeries(0x0100, series.data(), series.size());
+    EXPECT(size > ST25DV_RECORD_HEADER, "writeSeries returned %u", size);
+    std::vector<int32_t> seriesBack(series.size());
+    uint16_t count = tag.readSeries(0x0100, seriesBack.data(), seriesBack.size());
+    EXPECT((count == series.size()) && (seriesBack == series), "readSeries returned %u of %u samples", count, (unsigned)series.size());
+
+    std::vector<uint8_t> dat = bytes(2, 1000);
+    uint16_t reg = 0x0100 + size;
+    size = tag.writeCompressed(reg, dat.data(), dat.size());
+    EXPECT(size > ST25DV_RECORD_HEADER, "writeCompressed returned %u", size);
+    std::vector<uint8_t> datBack(dat.size());
+    uint16_t len = tag.readCompressed(reg, datBack.data(), datBack.size());
+    EXPECT((len == dat.size()) && (datBack == dat), "readCompressed returned %u of %u bytes", len, (unsigned)dat.size());
+
+    uint8_t prefix[37];
+    memset(prefix, 0xEE, sizeof(prefix));
+    len = tag.readCompressed(reg, prefix, 33);
+    EXPECT(len == 33, "readCompressed with maxLen 33 returned %u", len);
+    EXPECT(!memcmp(prefix, dat.data(), 33), "short read differs from the record");
+    EXPECT((prefix[33] == 0xEE) && (prefix[36] == 0xEE), "short read wrote past maxLen");
+    EXPECT(tag.readSeries(reg, seriesBack.data(), seriesBack.size()) == 0, "readSeries accepted an LZ record");
+}
+
+static void testNoFit(ST25DV &tag){
+    uint16_t end = tag.getLastAdd();
+    std::vector<uint8_t> dat = bytes(0, 200);
+    std::vector<int32_t> series = samples(0, 50);
+    std::map<uint32_t, uint8_t> before = Wire.mem;
+    uint32_t raw = tag.getRawBytes();
+    EXPECT(tag.writeCompressed(end - 100, dat.data(), dat.size()) == 0, "writeCompressed past the end of memory");
+    EXPECT(tag.writeSeries(end - 100, series.data(), series.size()) == 0, "writeSeries past the end of memory");
+    EXPECT(tag.writeCompressed(end - ST25DV_RECORD_HEADER + 2, dat.data(), 1) == 0, "writeCompressed header past the end of memory");
+    EXPECT(Wire.mem == before, "a record that does not fit changed the tag");
+    EXPECT(tag.getRawBytes() == raw, "a record that does not fit was counted");
+}
+
+int main(){
+    srand(25);
+    ST25DV tag;
+    tag.begin(Wire);
+    tag.enableDelay(false);
+    testCodecs();
+    testDeltaCorrupt();
+    testRecords(tag);
+    testNoFit(tag);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
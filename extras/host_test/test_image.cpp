@@ -0,0 +1,96 @@
+//============================================================================
+// Name        : test_image.cpp
+// Description : Host tests for dumpImage()/restoreImage(): a restore rewrites
+//               only what changed and brings back an identical image, and
+//               ENDA end points are restored in an order the tag accepts.
+//============================================================================
+
+#include "ST25DV.h"
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(cond, ...) do{if(!(cond)){printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++;}}while(0)
+
+//In-memory image, written by dumpImage and read back by restoreImage
+class ImageBuffer : public Stream
+{
+    public:
+        std::vector<uint8_t> data;
+        size_t pos = 0;
+        size_t write(uint8_t dat){
+            this->data.push_back(dat);
+            return 1;
+        }
+        int available(){
+            return this->data.size() - this->pos;
+        }
+        int read(){
+            return (this->pos < this->data.size()) ? this->data[this->pos++] : -1;
+        }
+        int peek(){
+            return (this->pos < this->data.size()) ? this->data[this->pos] : -1;
+        }
+};
+
+static void setEnda(ST25DV &tag, uint8_t enda1, uint8_t enda2, uint8_t enda3){
+    //Raise from the top, lower from the bottom, as the tag requires
+    tag.setByte(0x57, 0x0009, std::max(enda3, tag.getByte(0x57, 0x0009)));
+    tag.setByte(0x57, 0x0007, std::max(enda2, tag.getByte(0x57, 0x0007)));
+    tag.setByte(0x57, 0x0005, enda1);
+    tag.setByte(0x57, 0x0007, enda2);
+    tag.setByte(0x57, 0x0009, enda3);
+}
+
+static void testRoundTrip(ST25DV &tag){
+    for(uint16_t i = 0; i < 0x100; i++){tag.writeByte(i, i * 7);}
+    ImageBuffer image;
+    uint32_t dumped = tag.dumpImage(image);
+    EXPECT(dumped == image.data.size(), "dumpImage returned %u, wrote %u", dumped, (unsigned)image.data.size());
+
+    tag.writeByte(0x0041, 0xA5);//One user memory page
+    tag.setByte(0x57, 0x0001, tag.getByte(0x57, 0x0001) ^ 0x03);//IT_TIME
+    int32_t written = tag.restoreImage(image);
+    EXPECT(written == 1 + 4, "restoreImage returned %d, expected 1 config byte and 1 page", written);
+
+    ImageBuffer again;
+    tag.dumpImage(again);
+    EXPECT(again.data == image.data, "re-dump differs from the restored image");
+
+    image.pos = 0;
+    written = tag.restoreImage(image);
+    EXPECT(written == 0, "restoring an unchanged tag wrote %d bytes", written);
+}
+
+static void testEndaRaised(ST25DV &tag){
+    setEnda(tag, 0x40, 0x60, 0x80);
+    ImageBuffer image;
+    tag.dumpImage(image);
+
+    setEnda(tag, 0x10, 0x20, 0x30);//ENDA1 in the image is past the current ENDA2
+    int32_t written = tag.restoreImage(image);
+    EXPECT(written == 3, "restoreImage returned %d, expected 3 ENDA writes", written);
+    uint8_t enda1 = tag.getByte(0x57, 0x0005);
+    uint8_t enda2 = tag.getByte(0x57, 0x0007);
+    uint8_t enda3 = tag.getByte(0x57, 0x0009);
+    EXPECT((enda1 == 0x40) && (enda2 == 0x60) && (enda3 == 0x80), "ENDA left at 0x%02X 0x%02X 0x%02X", enda1, enda2, enda3);
+
+    setEnda(tag, 0xA0, 0xC0, 0xE0);//And lowered below the current ENDA1
+    image.pos = 0;
+    written = tag.restoreImage(image);
+    EXPECT(written == 3, "restoreImage returned %d, expected 3 ENDA writes", written);
+    ImageBuffer again;
+    tag.dumpImage(again);
+    EXPECT(again.data == image.data, "re-dump differs from the restored image");
+}
+
+int main(){
+    ST25DV tag;
+    tag.begin(Wire);
+    tag.enableDelay(false);
+    testRoundTrip(tag);
+    testEndaRaised(tag);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
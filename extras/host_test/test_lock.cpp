@@ -0,0 +1,63 @@
+//============================================================================
+// Name        : test_lock.cpp
+// Description : Host tests for ST25DV_THREADSAFE: read-modify-write sequences
+//               stay atomic across threads and mailbox accesses are served
+//               before queued normal accesses.
+//============================================================================
+
+#include "ST25DV.h"
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(cond, ...) do{if(!(cond)){printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++;}}while(0)
+
+static void testReadModifyWrite(ST25DV &tag){
+    const uint16_t reg = 0x2000;//GPO_CTRL_Dyn, no EEPROM delay
+    std::atomic<int> lost(0);
+    std::vector<std::thread> threads;
+    Wire.interleaved = 0;
+    for(uint8_t bit = 0; bit < 8; bit++){
+        threads.push_back(std::thread([&tag, &lost, reg, bit]{
+            for(int i = 0; i < 300; i++){
+                tag.setBit(0x53, reg, bit, 1);
+                if(!tag.getBit(0x53, reg, bit)){lost++;}
+                tag.setBit(0x53, reg, bit, 0);
+                if(tag.getBit(0x53, reg, bit)){lost++;}
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++){threads[i].join();}
+    EXPECT(lost == 0, "%d lost bit updates", (int)lost);
+    EXPECT(tag.getByte(0x53, reg) == 0, "register left at 0x%02X", tag.getByte(0x53, reg));
+    EXPECT(Wire.interleaved == 0, "%u interleaved bus calls", Wire.interleaved);
+}
+
+static void testMailboxPriority(ST25DV &tag){
+    Wire.log.clear();
+    tag.lock();//Hold the bus so both requests queue up
+    std::thread normal([&tag]{tag.readByte(0x0010);});
+    delay(50);
+    std::thread mailbox([&tag]{tag.getMailboxMessageSize();});
+    delay(50);
+    tag.unlock();
+    normal.join();
+    mailbox.join();
+    EXPECT(Wire.log.size() == 2, "%u transactions logged", (unsigned)Wire.log.size());
+    if(Wire.log.size() == 2){
+        EXPECT((Wire.log[0] == 0x2007) && (Wire.log[1] == 0x0010),
+            "served 0x%04X before 0x%04X, mailbox should go first", Wire.log[0], Wire.log[1]);
+    }
+}
+
+int main(){
+    ST25DV tag;
+    tag.begin(Wire);
+    tag.enableDelay(false);
+    testReadModifyWrite(tag);
+    testMailboxPriority(tag);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+//============================================================================
+// Name        : trace_analyzer.cpp
+// Description : Host tool for ST25DV::dumpTrace() output. Replays the dump
+//               against a simulated tag and prints per-API latency, redundant
+//               reads, transactions issued during an EEPROM write cycle and
+//               bus utilisation.
+//
+//               Build: g++ -std=c++11 -O2 -o trace_analyzer trace_analyzer.cpp
+//               Usage: trace_analyzer dump.bin [bus_hz=100000] [window_us=10000]
+//============================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define TRACE_VERSION 1
+#define TRACE_WRITE 0x80
+#define TRACE_SHORT_READ 0x40
+#define TRACE_STATUS 0x0F//Wire status in the low nibble
+#define ADDRESS 0x53
+#define ADDRESS_CONFIG 0x57
+#define PAGE_SIZE 4
+#define PAGE_WRITE_US 5000//Typical EEPROM programming time per page
+
+typedef struct
+{
+    uint32_t time;
+    uint16_t duration;
+    uint16_t reg;
+    uint16_t len;
+    uint8_t add;
+    uint8_t flags;
+}ST25DVTraceEntry;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t errors;//Wire status errors
+    uint32_t shortReads;
+    uint64_t measured;//Sum of recorded durations in us
+    uint32_t worst;
+    double simulated;//Sum of simulated bus time in us
+}apiStats;
+
+
+//Name of the library call a transaction most likely came from
+static std::string apiName(const ST25DVTraceEntry &e){
+    bool write = e.flags & TRACE_WRITE;
+    if(e.add == ADDRESS){
+        if(e.reg < 0x2000){return write ? "write (user memory)" : "read (user memory)";}
+        if(e.reg >= 0x2008){return write ? "writeMailbox" : "readMailbox";}
+        switch(e.reg){
+            case 0x2000: return "GPO_CTRL_Dyn";
+            case 0x2002: return "EH_CTRL_Dyn";
+            case 0x2003: return "RF_MNGT_Dyn";
+            case 0x2004: return "getI2CUnlocked";
+            case 0x2005: return "getInterruptSource";
+            case 0x2006: return "MB_CTRL_Dyn";
+            case 0x2007: return "getMailboxMessageSize";
+        }
+    }
+    else if(e.add == ADDRESS_CONFIG){
+        if(e.reg == 0x0900){return write ? (e.len == 17 ? "presentPassword" : "setI2CPass") : "getI2CPass";}
+        if(e.reg >= 0x0018 && e.reg < 0x0020){return "getUID";}
+        switch(e.reg){
+            case 0x0000: return "GPO";
+            case 0x0001: return "IT_TIME";
+            case 0x0002: return "EH_MODE";
+            case 0x0003: return "RF_MNGT";
+            case 0x0004: case 0x0006: case 0x0008: case 0x000A: return "RFZone";
+            case 0x0005: case 0x0007: case 0x0009: return "ENDA";
+            case 0x000B: return "I2CZoneLock";
+            case 0x000C: return "CCFileLock";
+            case 0x000D: return "MBEnabled";
+            case 0x000E: return "MBTimeout";
+            case 0x000F: return "RFCFGLock";
+            case 0x0014: return "getMemBlocks";
+            case 0x0015: return "getSizeK";
+            case 0x0016: return "getBlockSize";
+            case 0x0017: return "getICRef";
+            case 0x0020: return "getRevision";
+        }
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "0x%02X:0x%04X", e.add, e.reg);
+    return name;
+}
+
+//Bus time for one transaction: start, device address, 2 register bytes, data,
+//plus a repeated start and address for reads. 9 clocks per byte.
+static double busTime(const ST25DVTraceEntry &e, double hz){
+    uint32_t bytes = 3 + e.len + ((e.flags & TRACE_WRITE) ? 0 : 1);
+    return (bytes * 9 + 2) * 1e6 / hz;
+}
+
+static uint32_t le(const uint8_t *p, uint8_t n){
+    uint32_t v = 0;
+    for(uint8_t i = 0; i < n; i++){
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s dump.bin [bus_hz=100000] [window_us=10000]\n", argv[0]);
+        return 2;
+    }
+    double hz = (argc > 2) ? atof(argv[2]) : 100000;
+    uint32_t window = (argc > 3) ? strtoul(argv[3], NULL, 0) : 10000;
+
+    FILE *f = fopen(argv[1], "rb");
+    if(!f){
+        perror(argv[1]);
+        return 1;
+    }
+    uint8_t header[12];
+    if(fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "S25T", 4) || header[4] != TRACE_VERSION){
+        fprintf(stderr, "%s: not a version %d ST25DV trace\n", argv[1], TRACE_VERSION);
+        fclose(f);
+        return 1;
+    }
+    uint8_t entrySize = header[5];
+    uint32_t depth = le(header + 6, 2);
+    uint32_t total = le(header + 8, 4);
+
+    std::vector<ST25DVTraceEntry> trace;
+    std::vector<uint8_t> record(entrySize);
+    while(entrySize >= 12 && fread(record.data(), 1, entrySize, f) == entrySize){
+        ST25DVTraceEntry e;
+        e.time = le(&record[0], 4);
+        e.duration = le(&record[4], 2);
+        e.reg = le(&record[6], 2);
+        e.len = le(&record[8], 2);
+        e.add = record[10];
+        e.flags = record[11];
+        trace.push_back(e);
+    }
+    fclose(f);
+    printf("%u transactions recorded, %u in dump (ring depth %u)\n", total, (uint32_t)trace.size(), depth);
+    if(trace.empty()){return 0;}
+
+    //Replay against the simulated tag
+    std::map<std::string, apiStats> apis;
+    std::map<uint32_t, uint32_t> lastRead;//(add << 16 | reg) -> time of last read
+    std::map<std::string, uint32_t> redundant;
+    uint32_t redundantTotal = 0;
+    uint32_t duringWrite = 0;
+    uint32_t busyUntil = 0;//Simulated end of the tag's EEPROM write cycle
+    bool busy = false;//busyUntil is set, stays set once the first EEPROM write is seen
+    uint64_t measured = 0;
+    double simulated = 0;
+    for(size_t i = 0; i < trace.size(); i++){
+        const ST25DVTraceEntry &e = trace[i];
+        std::string name = apiName(e);
+        apiStats &s = apis[name];
+        double sim = busTime(e, hz);
+        s.count++;
+        s.errors += (e.flags & TRACE_STATUS) != 0;
+        s.shortReads += (e.flags & TRACE_SHORT_READ) != 0;
+        s.measured += e.duration;
+        s.simulated += sim;
+        if(e.duration > s.worst){s.worst = e.duration;}
+        measured += e.duration;
+        simulated += sim;
+
+        //The tag NACKs every access until it has finished programming EEPROM
+        if(busy && ((int32_t)(e.time - busyUntil) < 0)){duringWrite++;}
+
+        uint32_t key = ((uint32_t)e.add << 16) | e.reg;
+        if(e.flags & TRACE_WRITE){
+            //Presenting the password is a compare, it programs nothing
+            bool password = (e.add == ADDRESS_CONFIG) && (e.reg == 0x0900) && (e.len == 17);
+            bool eeprom = ((e.add == ADDRESS_CONFIG) && !password) || ((e.add == ADDRESS) && (e.reg < 0x2000));
+            if(eeprom){
+                uint32_t pages = ((e.reg % PAGE_SIZE) + e.len + PAGE_SIZE - 1) / PAGE_SIZE;
+                busyUntil = e.time + e.duration + pages * PAGE_WRITE_US;
+                busy = true;
+            }
+            for(uint16_t b = 0; b < e.len; b++){
+                lastRead.erase(key + b);
+            }
+        }
+        else{
+            std::map<uint32_t, uint32_t>::iterator prev = lastRead.find(key);
+            if(prev != lastRead.end() && (e.time - prev->second) <= window){
+                redundant[name]++;
+                redundantTotal++;
+            }
+            lastRead[key] = e.time;
+        }
+    }
+
+    printf("\n%-26s %8s %6s %6s %12s %10s %10s %12s\n", "API", "count", "errors", "short", "total us", "avg us", "worst us", "sim bus us");
+    for(std::map<std::string, apiStats>::iterator it = apis.begin(); it != apis.end(); ++it){
+        const apiStats &s = it->second;
+        printf("%-26s %8u %6u %6u %12llu %10.1f %10u %12.1f\n", it->first.c_str(), s.count, s.errors, s.shortReads,
+            (unsigned long long)s.measured, (double)s.measured / s.count, s.worst, s.simulated);
+    }
+
+    printf("\nRedundant reads (same register re-read within %u us, no write in between): %u\n", window, redundantTotal);
+    for(std::map<std::string, uint32_t>::iterator it = redundant.begin(); it != redundant.end(); ++it){
+        printf("  %-26s %u\n", it->first.c_str(), it->second);
+    }
+    printf("Transactions issued during a simulated EEPROM write cycle: %u\n", duringWrite);
+
+    const ST25DVTraceEntry &last = trace.back();
+    double span = (double)(uint32_t)(last.time + last.duration - trace.front().time);
+    if(span > 0){
+        printf("\nSpan %.0f us, measured bus utilisation %.1f%%, simulated at %.0f Hz %.1f%%\n",
+            span, 100.0 * measured / span, hz, 100.0 * simulated / span);
+    }
+    return 0;
+}
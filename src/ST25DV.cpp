@@ -12,13 +12,48 @@
 
 #include "ST25DV.h"
 
+#ifndef ST25DV_TRACE_DEPTH
+#define ST25DV_TRACE_DEPTH 0
+#endif
+static_assert((ST25DV_TRACE_DEPTH & (ST25DV_TRACE_DEPTH - 1)) == 0, "ST25DV_TRACE_DEPTH must be a power of two");
+
+#ifdef ST25DV_THREADSAFE
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+struct ST25DVLockState
+{
+    std::mutex state;//Guards the fields below, never held across a transaction
+    std::condition_variable free;
+    std::thread::id owner;
+    uint16_t depth = 0;
+    uint16_t priorityWaiting = 0;
+};
+#endif
+
 //Constructors
-    void ST25DV::ST25DV(){/*null constructor*/}
+    ST25DV::ST25DV(){
+#ifdef ST25DV_THREADSAFE
+        this->LOCK_STATE = new ST25DVLockState;
+#endif
+#if ST25DV_TRACE_DEPTH
+        this->TRACE = new ST25DVTraceEntry[ST25DV_TRACE_DEPTH];
+#endif
+    }
 
-    uint8_t ST25DV::begin(TwoWire &portin){
+    ST25DV::~ST25DV(){
+#ifdef ST25DV_THREADSAFE
+        delete this->LOCK_STATE;
+#endif
+        delete[] this->TRACE;
+    }
+
+    uint8_t ST25DV::begin(TwoWire &portin, bool autoClock){
         this->WIREPORT = &portin;
         this->BUILT_IN_DELAY = 1;
         uint8_t result = this->WIREPORT->begin();
+        if(autoClock){autoTuneClock();}
         this->MEMENDPOINT = getLastAdd();
         return result;
     }
@@ -29,14 +64,192 @@
 
 
 
+//Bus clock functions
+    uint32_t ST25DV::autoTuneClock(){
+        lock();
+        this->AUTO_CLOCK = false;//No runtime fallback while probing
+        applyClock(0);
+        uint32_t errors = this->BUS_ERRORS;
+        this->REF_UID = getUID();
+        this->REF_ICREF = getICRef();
+        this->REF_BLOCKS = getMemBlocks();
+        uint8_t best = 0;
+        if(errors == this->BUS_ERRORS){//Only step up from a clean reference read
+            while((best < 2) && probeClock(best + 1)){
+                best++;
+            }
+        }
+        applyClock(best);
+        this->TUNED_INDEX = best;
+        this->AUTO_CLOCK = true;
+        unlock();
+        return this->BUS_CLOCK;
+    }
+
+    void ST25DV::setBusClock(uint32_t hz){
+        lock();
+        this->AUTO_CLOCK = false;
+        this->BUS_CLOCK = hz;
+        this->CLOCK_ERRORS = 0;
+        this->WINDOW_TRANSACTIONS = 0;
+        this->WIREPORT->setClock(hz);
+        unlock();
+    }
+
+    uint32_t ST25DV::getBusClock(){
+        return this->BUS_CLOCK;
+    }
+
+    uint32_t ST25DV::getBusErrors(){
+        return this->BUS_ERRORS;
+    }
+
+    uint16_t ST25DV::getClockErrors(){
+        return this->CLOCK_ERRORS;
+    }
+
+    void ST25DV::applyClock(uint8_t index){
+        this->CLOCK_INDEX = index;
+        this->BUS_CLOCK = this->BUS_CLOCKS[index];
+        this->CLOCK_ERRORS = 0;
+        this->WINDOW_TRANSACTIONS = 0;
+        this->CLEAN_WINDOWS = 0;
+        this->WIREPORT->setClock(this->BUS_CLOCK);
+    }
+
+    //Reads the autoTuneClock() reference values at BUS_CLOCKS[index]. Keeps the
+    //new rate if they all read back cleanly, otherwise goes back to the old one.
+    //Call with the bus locked and AUTO_CLOCK false.
+    bool ST25DV::probeClock(uint8_t index){
+        uint8_t previous = this->CLOCK_INDEX;
+        uint32_t errors = this->BUS_ERRORS;
+        applyClock(index);
+        bool pass = true;
+        for(uint8_t n = 0; (n < 4) && pass; n++){
+            pass = (getUID() == this->REF_UID) && (getICRef() == this->REF_ICREF) && (getMemBlocks() == this->REF_BLOCKS);
+        }
+        pass = pass && (errors == this->BUS_ERRORS);
+        this->BUS_ERRORS = errors;//Probe failures are expected, don't report them
+        applyClock(pass ? index : previous);
+        return pass;
+    }
+
+    //Called with the bus locked after every transaction, with the trace flags.
+    //An address NACK (Wire status 2) is also how the tag signals a write cycle
+    //in progress or an RF session holding the bus, so it never drives the clock
+    //fallback, and only counts as a bus error when the built-in delays rule out
+    //a write cycle. Stepping back up probes the higher rate first, after a
+    //clean read so a write cycle cannot fail the probe.
+    void ST25DV::busResult(uint8_t flags){
+        uint8_t status = flags & ~ST25DV_TRACE_WRITE;
+        if(status && ((status != 2) || this->BUILT_IN_DELAY)){this->BUS_ERRORS++;}
+        if(status && (status != 2)){this->CLOCK_ERRORS++;}
+        this->WINDOW_TRANSACTIONS++;
+        if(!this->AUTO_CLOCK){
+            if(this->WINDOW_TRANSACTIONS >= ST25DV_CLOCK_WINDOW){
+                this->WINDOW_TRANSACTIONS = 0;
+                this->CLOCK_ERRORS = 0;
+            }
+            return;
+        }
+        if(this->CLOCK_INDEX && (this->CLOCK_ERRORS >= ST25DV_CLOCK_FALLBACK_ERRORS)){
+            applyClock(this->CLOCK_INDEX - 1);
+            return;
+        }
+        if(this->WINDOW_TRANSACTIONS >= ST25DV_CLOCK_WINDOW){
+            if(this->CLOCK_ERRORS){this->CLEAN_WINDOWS = 0;}
+            else if(this->CLEAN_WINDOWS < ST25DV_CLOCK_RECOVER_WINDOWS){this->CLEAN_WINDOWS++;}
+            this->WINDOW_TRANSACTIONS = 0;
+            this->CLOCK_ERRORS = 0;
+        }
+        if((this->CLEAN_WINDOWS >= ST25DV_CLOCK_RECOVER_WINDOWS) && (this->CLOCK_INDEX < this->TUNED_INDEX) && !flags){
+            this->AUTO_CLOCK = false;
+            probeClock(this->CLOCK_INDEX + 1);//Either way the counters start over
+            this->AUTO_CLOCK = true;
+        }
+    }
+
+
+
+//Bus arbitration
+    //Every transaction (and every read-modify-write sequence) runs between
+    //lock() and unlock(). Waiters queue on the condition variable; a priority
+    //waiter (mailbox traffic) blocks new normal acquisitions until it is served,
+    //so a mailbox access waits for at most one in-flight transaction.
+    void ST25DV::lock(bool priority){
+#ifdef ST25DV_THREADSAFE
+        ST25DVLockState &l = *this->LOCK_STATE;
+        std::unique_lock<std::mutex> guard(l.state);
+        if(l.depth && (l.owner == std::this_thread::get_id())){
+            l.depth++;
+            return;
+        }
+        if(priority){l.priorityWaiting++;}
+        l.free.wait(guard, [&l, priority]{
+            return !l.depth && (priority || !l.priorityWaiting);
+        });
+        if(priority){l.priorityWaiting--;}
+        l.owner = std::this_thread::get_id();
+        l.depth = 1;
+#else
+        (void)priority;
+#endif
+    }
+
+    void ST25DV::unlock(){
+#ifdef ST25DV_THREADSAFE
+        ST25DVLockState &l = *this->LOCK_STATE;
+        std::unique_lock<std::mutex> guard(l.state);
+        if(l.depth && (--l.depth == 0)){
+            l.owner = std::thread::id();
+            guard.unlock();
+            l.free.notify_all();
+        }
+#endif
+    }
+
+    bool ST25DV::isMailboxReg(uint8_t add, uint16_t reg){
+        return (add == this->ADDRESS) && (reg >= this->REG_MB_CTRL_Dyn) && (reg <= this->REG_FAST_TRANSFER_END);
+    }
+
+
+
+//Transaction trace hooks, compiled away without ST25DV_TRACE_DEPTH
+    inline uint32_t ST25DV::traceStart(){
+#if ST25DV_TRACE_DEPTH
+        return micros();
+#else
+        return 0;
+#endif
+    }
+
+    inline void ST25DV::trace(uint8_t add, uint16_t reg, uint16_t len, uint8_t flags, uint32_t start){
+#if ST25DV_TRACE_DEPTH
+        ST25DVTraceEntry &e = this->TRACE[this->TRACE_COUNT++ & (ST25DV_TRACE_DEPTH - 1)];
+        uint32_t duration = micros() - start;
+        e.time = start;
+        e.duration = (duration > 0xFFFF) ? 0xFFFF : duration;
+        e.reg = reg;
+        e.len = len;
+        e.add = add;
+        e.flags = flags;
+#else
+        (void)add; (void)reg; (void)len; (void)flags; (void)start;
+#endif
+    }
+
+
+
 //Worker functions
     
     uint64_t ST25DV::get64bits(uint8_t add, uint16_t reg){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         this->WIREPORT->beginTransmission(add);
         this->WIREPORT->write(reg >> 8);
         this->WIREPORT->write(reg & 0xFF);
-        this->WIREPORT->endTransmission();
-        this->WIREPORT->requestFrom(add, 8);
+        uint8_t status = this->WIREPORT->endTransmission();
+        if((this->WIREPORT->requestFrom(add, 8) != 8) && !status){status = ST25DV_TRACE_SHORT_READ;}
         uint64_t buffer = 0;
         buffer |= this->WIREPORT->read();
         for(uint8_t i = 0; i < 7; i++){
@@ -44,42 +257,80 @@
             buffer |= this->WIREPORT->read();
         }
         this->WIREPORT->endTransmission();
+        trace(add, reg, 8, status, start);
+        busResult(status);
+        unlock();
         return buffer;
     }
 
     uint16_t ST25DV::get16bits(uint8_t add, uint16_t reg){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         this->WIREPORT->beginTransmission(add);
         this->WIREPORT->write(reg >> 8);
         this->WIREPORT->write(reg & 0xFF);
-        this->WIREPORT->endTransmission();
-        this->WIREPORT->requestFrom(add, 8);
+        uint8_t status = this->WIREPORT->endTransmission();
+        if((this->WIREPORT->requestFrom(add, 8) != 8) && !status){status = ST25DV_TRACE_SHORT_READ;}
         uint16_t buffer = 0;
         buffer |= this->WIREPORT->read();
         buffer <<= 8;
         buffer |= this->WIREPORT->read();
         this->WIREPORT->endTransmission();
+        trace(add, reg, 8, status, start);
+        busResult(status);
+        unlock();
         return buffer;
     }
     
     uint8_t ST25DV::getByte(uint8_t add, uint16_t reg){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         this->WIREPORT->beginTransmission(add);
         this->WIREPORT->write(reg >> 8);
         this->WIREPORT->write(reg & 0xFF);
-        this->WIREPORT->endTransmission();
-        this->WIREPORT->requestFrom(add, 1);
+        uint8_t status = this->WIREPORT->endTransmission();
+        if((this->WIREPORT->requestFrom(add, 1) != 1) && !status){status = ST25DV_TRACE_SHORT_READ;}
         uint8_t buffer = this->WIREPORT->read();
         this->WIREPORT->endTransmission();
+        trace(add, reg, 1, status, start);
+        busResult(status);
+        unlock();
         return buffer;
     }
     
-    bool ST25DV::getBit(uint8_t add, uint8_t reg, uint8_t bit){
+    bool ST25DV::getBit(uint8_t add, uint16_t reg, uint8_t bit){
         uint8_t buffer = getByte(add, reg);
         buffer >>= bit;
         buffer &= 0x01;
         return buffer;
     }
 
+    void ST25DV::getBulk(uint8_t add, uint16_t reg, uint16_t len, uint8_t* dat){
+        while(len){
+            uint8_t n = (len < ST25DV_I2C_CHUNK) ? len : ST25DV_I2C_CHUNK;
+            lock(isMailboxReg(add, reg));//Per chunk, so long reads never starve the mailbox
+            uint32_t start = traceStart();
+            this->WIREPORT->beginTransmission(add);
+            this->WIREPORT->write(reg >> 8);
+            this->WIREPORT->write(reg & 0xFF);
+            uint8_t status = this->WIREPORT->endTransmission();
+            if((this->WIREPORT->requestFrom(add, n) != n) && !status){status = ST25DV_TRACE_SHORT_READ;}
+            for(uint8_t i = 0; i < n; i++){
+                dat[i] = this->WIREPORT->read();
+            }
+            this->WIREPORT->endTransmission();
+            trace(add, reg, n, status, start);
+            busResult(status);
+            unlock();
+            reg += n;
+            dat += n;
+            len -= n;
+        }
+    }
+
     void ST25DV::set64bits(uint8_t add, uint16_t reg, uint64_t dat){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         array64bits adat;
         adat.d64 = dat;
         this->WIREPORT->beginTransmission(add);
@@ -88,37 +339,81 @@
         for(uint8_t i = 0; i<8; i++){
             this->WIREPORT->write(adat.d8[7-i]);
         }
-        this->WIREPORT->endTransmission();
+        uint8_t status = this->WIREPORT->endTransmission();
+        trace(add, reg, 8, ST25DV_TRACE_WRITE | status, start);
+        busResult(ST25DV_TRACE_WRITE | status);
         if(this->BUILT_IN_DELAY){delay(18);}//Maximum EEPROM write time in ms (6ms * up to 3 pages to write)
+        unlock();
     }
 
     void ST25DV::set16bits(uint8_t add, uint16_t reg, uint16_t dat){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         this->WIREPORT->beginTransmission(add);
         this->WIREPORT->write(reg >> 8);
         this->WIREPORT->write(reg & 0xFF);
         this->WIREPORT->write(dat >> 8);
         this->WIREPORT->write(dat & 0xFF);
-        this->WIREPORT->endTransmission();
+        uint8_t status = this->WIREPORT->endTransmission();
+        trace(add, reg, 2, ST25DV_TRACE_WRITE | status, start);
+        busResult(ST25DV_TRACE_WRITE | status);
         if(this->BUILT_IN_DELAY){delay(12);}//Maximum EEPROM write time in ms (6ms * up to 2 pages to write)
+        unlock();
     }
 
     void ST25DV::setByte(uint8_t add, uint16_t reg, uint8_t dat){
+        lock(isMailboxReg(add, reg));
+        uint32_t start = traceStart();
         this->WIREPORT->beginTransmission(add);
         this->WIREPORT->write(reg >> 8);
         this->WIREPORT->write(reg & 0xFF);
         this->WIREPORT->write(dat);
-        this->WIREPORT->endTransmission();
+        uint8_t status = this->WIREPORT->endTransmission();
+        trace(add, reg, 1, ST25DV_TRACE_WRITE | status, start);
+        busResult(ST25DV_TRACE_WRITE | status);
         if(this->BUILT_IN_DELAY){delay(6);}//Maximum EEPROM write time in ms (6ms * up to 1 page to write)
+        unlock();
     }
 
-    void ST25DV::setBit(uint8_t add, uint8_t reg, uint8_t bit, bool dat){
+    void ST25DV::setBit(uint8_t add, uint16_t reg, uint8_t bit, bool dat){
+        lock(isMailboxReg(add, reg));
         uint8_t mask = 0x01 << bit;
         uint8_t buffer = getByte(add, reg);
         buffer = dat ? buffer | mask : buffer & ~mask;
         setByte(add, reg, buffer);
+        unlock();
+    }
+
+    void ST25DV::setBulk(uint8_t add, uint16_t reg, uint16_t len, const uint8_t* dat){
+        //Largest whole number of pages that fits in one transaction after the 2 address bytes
+        const uint8_t room = (ST25DV_I2C_CHUNK - 2) - ((ST25DV_I2C_CHUNK - 2) % this->PAGE_SIZE);
+        while(len){
+            uint8_t n = room - (reg % this->PAGE_SIZE);//End each transaction on a page boundary
+            if(n > len){n = len;}
+            lock(isMailboxReg(add, reg));
+            uint32_t start = traceStart();
+            this->WIREPORT->beginTransmission(add);
+            this->WIREPORT->write(reg >> 8);
+            this->WIREPORT->write(reg & 0xFF);
+            for(uint8_t i = 0; i < n; i++){
+                this->WIREPORT->write(dat[i]);
+            }
+            uint8_t status = this->WIREPORT->endTransmission();
+            trace(add, reg, n, ST25DV_TRACE_WRITE | status, start);
+            busResult(ST25DV_TRACE_WRITE | status);
+            if(this->BUILT_IN_DELAY){//Maximum EEPROM write time in ms (6ms * pages touched)
+                delay(6 * (((reg % this->PAGE_SIZE) + n + this->PAGE_SIZE - 1) / this->PAGE_SIZE));
+            }
+            unlock();
+            reg += n;
+            dat += n;
+            len -= n;
+        }
     }
 
     bool ST25DV::presentPassword(uint64_t pass){
+        lock();
+        uint32_t start = traceStart();
         array64bits adat;
         adat.d64 = pass;
         this->WIREPORT->beginTransmission(this->ADDRESS_CONFIG);
@@ -131,22 +426,32 @@
         for(uint8_t i = 0; i<8; i++){
             this->WIREPORT->write(adat.d8[7-i]);
         }
-        this->WIREPORT->endTransmission();
+        uint8_t status = this->WIREPORT->endTransmission();
+        trace(this->ADDRESS_CONFIG, this->REG_I2C_PWD_START, 17, ST25DV_TRACE_WRITE | status, start);
+        busResult(ST25DV_TRACE_WRITE | status);
+        bool unlocked = 1;
         if(this->BUILT_IN_DELAY){//Password comparison check delay and unlock verification
             delay(10);
-            return getI2CUnlocked();
+            unlocked = getI2CUnlocked();
         }
-        return 1;
+        unlock();
+        return unlocked;
     }
 
 //User memory functions
-    /*uint8_t* ST25DV::read(uint16_t reg, uint8_t len){
-        return getBulk(this->ADDRESS, reg, len);
+    void ST25DV::read(uint16_t reg, uint16_t len, uint8_t* dat){
+        if(reg <= this->MEMENDPOINT){
+            if(len > this->MEMENDPOINT - reg + 1){len = this->MEMENDPOINT - reg + 1;}
+            getBulk(this->ADDRESS, reg, len, dat);
+        }
     }
 
-    void ST25DV::write(uint16_t reg, uint8_t len, uint8_t* dat){
-        setBulk(this->ADDRESS, reg, len, dat);
-    }*/
+    void ST25DV::write(uint16_t reg, uint16_t len, const uint8_t* dat){
+        if(reg <= this->MEMENDPOINT){
+            if(len > this->MEMENDPOINT - reg + 1){len = this->MEMENDPOINT - reg + 1;}
+            setBulk(this->ADDRESS, reg, len, dat);
+        }
+    }
     
     uint8_t ST25DV::readByte(uint16_t reg){
         if(reg < this->MEMENDPOINT){
@@ -161,6 +466,357 @@
         }
     }
 
+//Tag image functions
+    uint32_t ST25DV::dumpImage(Print &out){
+        uint8_t header[18] = {'S', 'T', '2', '5', ST25DV_IMAGE_VERSION, getICRef(), getRevision()};
+        uint16_t sizeK = getSizeK();
+        header[7] = sizeK & 0xFF;
+        header[8] = sizeK >> 8;
+        uint64_t uid = getUID();
+        for(uint8_t i = 0; i < 8; i++){
+            header[9 + i] = uid >> (8 * i);
+        }
+        header[17] = this->IMAGE_CONFIG_LEN;
+        uint32_t count = out.write(header, sizeof(header));
+
+        uint8_t buffer[ST25DV_I2C_CHUNK];
+        for(uint16_t reg = this->REG_GPO; reg < this->REG_GPO + this->IMAGE_CONFIG_LEN; reg += ST25DV_I2C_CHUNK){
+            uint8_t n = min((uint16_t)ST25DV_I2C_CHUNK, (uint16_t)(this->REG_GPO + this->IMAGE_CONFIG_LEN - reg));
+            getBulk(this->ADDRESS_CONFIG, reg, n, buffer);
+            count += out.write(buffer, n);
+        }
+        for(uint32_t reg = this->REG_USER_MEM_START; reg <= this->MEMENDPOINT; reg += ST25DV_I2C_CHUNK){
+            uint8_t n = min((uint32_t)ST25DV_I2C_CHUNK, (uint32_t)(this->MEMENDPOINT + 1 - reg));
+            getBulk(this->ADDRESS, reg, n, buffer);
+            count += out.write(buffer, n);
+        }
+        return count;
+    }
+
+    //Config registers and user memory areas must be writable (I2C security
+    //session open via presentPassword, zones not write locked) for a full restore.
+    int32_t ST25DV::restoreImage(Stream &in){
+        uint8_t header[18];
+        if(in.readBytes(header, sizeof(header)) != sizeof(header)){return ST25DV_IMAGE_ERR_SHORT;}
+        if(memcmp(header, "ST25", 4) || (header[4] != ST25DV_IMAGE_VERSION)){return ST25DV_IMAGE_ERR_HEADER;}
+        if((header[5] != getICRef()) || ((header[7] | (header[8] << 8)) != getSizeK())){return ST25DV_IMAGE_ERR_TAG;}
+
+        //System config: rewrite only the writable registers that differ
+        uint8_t config[IMAGE_CONFIG_RW_LEN];
+        if(header[17] < IMAGE_CONFIG_RW_LEN){return ST25DV_IMAGE_ERR_HEADER;}
+        for(uint8_t i = 0; i < header[17]; i++){
+            uint8_t dat;
+            if(in.readBytes(&dat, 1) != 1){return ST25DV_IMAGE_ERR_SHORT;}
+            if(i < IMAGE_CONFIG_RW_LEN){config[i] = dat;}
+        }
+        int32_t written = 0;
+        bool ok = true;
+        for(uint8_t i = 0; (i < IMAGE_CONFIG_RW_LEN) && ok; i++){
+            uint16_t reg = this->REG_GPO + i;
+            if((reg != this->REG_ENDA1) && (reg != this->REG_ENDA2) && (reg != this->REG_ENDA3)){
+                ok = restoreConfigByte(reg, config[i], written);
+            }
+        }
+        //The tag rejects ENDA writes that break ENDA1 <= ENDA2 <= ENDA3. Raising
+        //end points from the top down, then lowering them from the bottom up,
+        //keeps the order valid after every single write.
+        const uint16_t enda[3] = {this->REG_ENDA1, this->REG_ENDA2, this->REG_ENDA3};
+        for(int8_t i = 2; (i >= 0) && ok; i--){
+            uint8_t dat = config[enda[i] - this->REG_GPO];
+            if(dat > getByte(this->ADDRESS_CONFIG, enda[i])){
+                ok = restoreConfigByte(enda[i], dat, written);
+            }
+        }
+        for(uint8_t i = 0; (i < 3) && ok; i++){
+            uint8_t dat = config[enda[i] - this->REG_GPO];
+            if(dat < getByte(this->ADDRESS_CONFIG, enda[i])){
+                ok = restoreConfigByte(enda[i], dat, written);
+            }
+        }
+
+        //User memory: compare chunk by chunk, rewrite runs of differing pages and read them back
+        const uint8_t chunk = ST25DV_I2C_CHUNK - (ST25DV_I2C_CHUNK % this->PAGE_SIZE);
+        uint8_t image[ST25DV_I2C_CHUNK];
+        uint8_t tag[ST25DV_I2C_CHUNK];
+        for(uint32_t reg = this->REG_USER_MEM_START; (reg <= this->MEMENDPOINT) && ok; reg += chunk){
+            uint8_t n = min((uint32_t)chunk, (uint32_t)(this->MEMENDPOINT + 1 - reg));
+            if(in.readBytes(image, n) != n){return ST25DV_IMAGE_ERR_SHORT;}
+            getBulk(this->ADDRESS, reg, n, tag);
+            uint8_t run = 0;
+            bool inRun = false;
+            bool changed = false;
+            for(uint8_t page = 0; page < n; page += this->PAGE_SIZE){
+                uint8_t pageLen = min((uint8_t)this->PAGE_SIZE, (uint8_t)(n - page));
+                bool differs = memcmp(image + page, tag + page, pageLen) != 0;
+                if(differs && !inRun){
+                    run = page;
+                    inRun = true;
+                }
+                else if(!differs && inRun){
+                    setBulk(this->ADDRESS, reg + run, page - run, image + run);
+                    restoreWait(reg + run, page - run);
+                    written += page - run;
+                    inRun = false;
+                    changed = true;
+                }
+            }
+            if(inRun){
+                setBulk(this->ADDRESS, reg + run, n - run, image + run);
+                restoreWait(reg + run, n - run);
+                written += n - run;
+                changed = true;
+            }
+            if(changed){
+                getBulk(this->ADDRESS, reg, n, tag);
+                ok = memcmp(image, tag, n) == 0;
+            }
+        }
+        if(!ok){return ST25DV_IMAGE_ERR_WRITE;}
+        return written;
+    }
+
+
+
+    //Writes one config register if it differs and reads it back. False when
+    //the tag did not take the value (no security session, locked, invalid).
+    bool ST25DV::restoreConfigByte(uint16_t reg, uint8_t dat, int32_t &written){
+        if(getByte(this->ADDRESS_CONFIG, reg) == dat){return true;}
+        setByte(this->ADDRESS_CONFIG, reg, dat);
+        restoreWait(reg, 1);
+        if(getByte(this->ADDRESS_CONFIG, reg) != dat){return false;}
+        written++;
+        return true;
+    }
+
+
+
+    //Read-back needs the write cycle finished. setByte/setBulk only wait with
+    //enableDelay, so wait here otherwise rather than touch the shared flag.
+    void ST25DV::restoreWait(uint16_t reg, uint16_t len){
+        if(!this->BUILT_IN_DELAY){
+            delay(6 * (((reg % this->PAGE_SIZE) + len + this->PAGE_SIZE - 1) / this->PAGE_SIZE));
+        }
+    }
+
+
+
+//Compressed record functions
+    namespace{
+    //Collects encoded bytes and writes them out in whole pages. Each payload
+    //page is programmed once, except the first one, which shares its page with
+    //the header and is programmed again when the header is written.
+    struct recordWriter
+    {
+        ST25DV *tag;
+        uint16_t reg;
+        uint8_t pos;
+        uint8_t buffer[ST25DV_I2C_CHUNK];
+
+        recordWriter(ST25DV *tag, uint16_t reg){
+            this->tag = tag;
+            this->reg = reg;
+            this->pos = 0;
+        }
+
+        void emit(const uint8_t* dat, uint8_t len){
+            for(uint8_t i = 0; i < len; i++){
+                this->buffer[this->pos++] = dat[i];
+                if(this->pos == ST25DV_I2C_CHUNK){flush(0);}
+            }
+        }
+
+        void flush(bool last){
+            uint8_t n = last ? this->pos : this->pos - ((this->reg + this->pos) % 4);//Keep a partial page for later
+            this->tag->write(this->reg, n, this->buffer);
+            memmove(this->buffer, this->buffer + n, this->pos - n);
+            this->reg += n;
+            this->pos -= n;
+        }
+    };
+    }
+
+    //A record fits when its header and payload end at or before MEMENDPOINT
+    //and the payload length fits the 2-byte header field
+    bool ST25DV::recordFits(uint16_t reg, uint32_t len){
+        return (len <= 0xFFFF) && ((uint32_t)reg + ST25DV_RECORD_HEADER + len <= (uint32_t)this->MEMENDPOINT + 1);
+    }
+
+    uint16_t ST25DV::writeSeries(uint16_t reg, const int32_t* samples, uint16_t count){
+        //Size the payload first so a record that does not fit leaves the tag untouched
+        uint8_t encoded[5];
+        uint32_t size = 0;
+        ST25DVDeltaEncoder sizer;
+        for(uint16_t i = 0; i < count; i++){
+            size += sizer.push(samples[i], encoded);
+        }
+        if(!recordFits(reg, size)){return 0;}
+
+        recordWriter out(this, reg + ST25DV_RECORD_HEADER);
+        ST25DVDeltaEncoder encoder;
+        for(uint16_t i = 0; i < count; i++){
+            out.emit(encoded, encoder.push(samples[i], encoded));
+        }
+        out.flush(1);
+        uint8_t header[ST25DV_RECORD_HEADER] = {ST25DV_CODEC_DELTA, (uint8_t)count, (uint8_t)(count >> 8), (uint8_t)size, (uint8_t)(size >> 8)};
+        write(reg, ST25DV_RECORD_HEADER, header);
+        this->RAW_BYTES += (uint32_t)count * sizeof(int32_t);
+        this->STORED_BYTES += ST25DV_RECORD_HEADER + size;
+        return ST25DV_RECORD_HEADER + size;
+    }
+
+    uint16_t ST25DV::writeCompressed(uint16_t reg, const uint8_t* dat, uint16_t len){
+        //Size the payload first so a record that does not fit leaves the tag untouched
+        uint8_t encoded[ST25DV_LZ_MAX_LITERALS + 1];
+        uint32_t size = 0;
+        uint16_t pos = 0;
+        while(pos < len){
+            size += ST25DVLZEncoder::next(dat, len, pos, encoded);
+        }
+        if(!recordFits(reg, size)){return 0;}
+
+        recordWriter out(this, reg + ST25DV_RECORD_HEADER);
+        pos = 0;
+        while(pos < len){
+            out.emit(encoded, ST25DVLZEncoder::next(dat, len, pos, encoded));
+        }
+        out.flush(1);
+        uint8_t header[ST25DV_RECORD_HEADER] = {ST25DV_CODEC_LZ, (uint8_t)len, (uint8_t)(len >> 8), (uint8_t)size, (uint8_t)(size >> 8)};
+        write(reg, ST25DV_RECORD_HEADER, header);
+        this->RAW_BYTES += len;
+        this->STORED_BYTES += ST25DV_RECORD_HEADER + size;
+        return ST25DV_RECORD_HEADER + size;
+    }
+
+    bool ST25DV::readRecordHeader(uint16_t reg, uint8_t codec, uint16_t &count, uint16_t &len){
+        uint8_t header[ST25DV_RECORD_HEADER];
+        if(!recordFits(reg, 0)){return 0;}
+        read(reg, ST25DV_RECORD_HEADER, header);
+        count = header[1] | (header[2] << 8);
+        len = header[3] | (header[4] << 8);
+        return (header[0] == codec) && recordFits(reg, len);
+    }
+
+    uint16_t ST25DV::readSeries(uint16_t reg, int32_t* samples, uint16_t maxCount){
+        uint16_t count, len;
+        if(!readRecordHeader(reg, ST25DV_CODEC_DELTA, count, len)){return 0;}
+        if(count > maxCount){count = maxCount;}
+        ST25DVDeltaDecoder decoder;
+        uint8_t buffer[ST25DV_I2C_CHUNK];
+        uint16_t decoded = 0;
+        reg += ST25DV_RECORD_HEADER;
+        while(len && (decoded < count)){//Stops reading the tag once enough samples are out
+            uint8_t n = (len < ST25DV_I2C_CHUNK) ? len : ST25DV_I2C_CHUNK;
+            read(reg, n, buffer);
+            for(uint8_t i = 0; (i < n) && (decoded < count); i++){
+                if(decoder.push(buffer[i], samples[decoded])){decoded++;}
+            }
+            reg += n;
+            len -= n;
+        }
+        return decoded;
+    }
+
+    uint16_t ST25DV::readCompressed(uint16_t reg, uint8_t* dat, uint16_t maxLen){
+        uint16_t count, len;
+        if(!readRecordHeader(reg, ST25DV_CODEC_LZ, count, len)){return 0;}
+        if(count > maxLen){count = maxLen;}
+        ST25DVLZDecoder decoder;
+        uint8_t buffer[ST25DV_I2C_CHUNK];
+        uint16_t decoded = 0;
+        reg += ST25DV_RECORD_HEADER;
+        while(len && (decoded < count)){
+            uint8_t n = (len < ST25DV_I2C_CHUNK) ? len : ST25DV_I2C_CHUNK;
+            read(reg, n, buffer);
+            for(uint8_t i = 0; (i < n) && (decoded < count); i++){
+                decoder.push(buffer[i]);
+                while(decoder.available() && (decoded < count)){
+                    dat[decoded++] = decoder.read();
+                }
+            }
+            reg += n;
+            len -= n;
+        }
+        return decoded;
+    }
+
+    uint32_t ST25DV::getRawBytes(){
+        return this->RAW_BYTES;
+    }
+
+    uint32_t ST25DV::getStoredBytes(){
+        return this->STORED_BYTES;
+    }
+
+    int32_t ST25DV::getBytesSaved(){
+        return (int32_t)this->RAW_BYTES - (int32_t)this->STORED_BYTES;
+    }
+
+    float ST25DV::getCompressionRatio(){
+        return this->STORED_BYTES ? (float)this->RAW_BYTES / this->STORED_BYTES : 1.0;
+    }
+
+
+
+//Transaction trace functions
+    //Only copying is done under the lock, writing to out can take far longer
+    //than the other threads should wait for the bus. Entries overwritten while
+    //unlocked are skipped, a clearTrace() ends the dump.
+    uint32_t ST25DV::dumpTrace(Print &out){
+#if ST25DV_TRACE_DEPTH
+        lock();
+        uint32_t total = this->TRACE_COUNT;
+        unlock();
+#else
+        uint32_t total = 0;
+#endif
+        uint8_t header[12] = {'S', '2', '5', 'T', ST25DV_TRACE_VERSION, 12,
+            ST25DV_TRACE_DEPTH & 0xFF, ST25DV_TRACE_DEPTH >> 8,
+            (uint8_t)total, (uint8_t)(total >> 8), (uint8_t)(total >> 16), (uint8_t)(total >> 24)};
+        uint32_t count = out.write(header, sizeof(header));
+#if ST25DV_TRACE_DEPTH
+        uint8_t records[ST25DV_TRACE_BATCH * 12];
+        uint32_t i = (total > ST25DV_TRACE_DEPTH) ? total - ST25DV_TRACE_DEPTH : 0;
+        while(i < total){
+            uint8_t n = 0;
+            lock();
+            if(this->TRACE_COUNT < total){//Cleared
+                unlock();
+                break;
+            }
+            if(this->TRACE_COUNT - i > ST25DV_TRACE_DEPTH){i = this->TRACE_COUNT - ST25DV_TRACE_DEPTH;}
+            for(; (i < total) && (n < ST25DV_TRACE_BATCH); i++, n++){
+                const ST25DVTraceEntry &e = this->TRACE[i & (ST25DV_TRACE_DEPTH - 1)];
+                uint8_t *record = records + n * 12;
+                record[0] = e.time;
+                record[1] = e.time >> 8;
+                record[2] = e.time >> 16;
+                record[3] = e.time >> 24;
+                record[4] = e.duration;
+                record[5] = e.duration >> 8;
+                record[6] = e.reg;
+                record[7] = e.reg >> 8;
+                record[8] = e.len;
+                record[9] = e.len >> 8;
+                record[10] = e.add;
+                record[11] = e.flags;
+            }
+            unlock();
+            count += out.write(records, n * 12);
+        }
+#endif
+        return count;
+    }
+
+    void ST25DV::clearTrace(){
+#if ST25DV_TRACE_DEPTH
+        lock();
+        this->TRACE_COUNT = 0;
+        unlock();
+#endif
+    }
+
+
+
 //Dynamic register functions
     bool ST25DV::getGPOEnabledDyn(){
         return getBit(this->ADDRESS, this->REG_GPO_CTRL_Dyn, 7);
@@ -273,9 +929,11 @@
     }
 
     void ST25DV::setGPOMode(uint8_t mode){
+        lock();
         uint8_t buffer = getByte(this->ADDRESS_CONFIG, this->REG_GPO) & 0x80;
         buffer |= (mode & 0x7F);
         setByte(this->ADDRESS_CONFIG, this->REG_GPO, buffer);
+        unlock();
     }
 
     bool ST25DV::getGPOEnabledBoot(){
@@ -381,9 +1039,11 @@
                 default:
                     break;
             }
+            lock();
             uint8_t buffer = getByte(this->ADDRESS_CONFIG, add) & 0xFC;
             buffer |= (pass & 0x03);
             setByte(this->ADDRESS_CONFIG, add, buffer);
+            unlock();
         }
     }
 
@@ -421,9 +1081,11 @@
                 default:
                     break;
             }
+            lock();
             uint8_t buffer = getByte(this->ADDRESS_CONFIG, add) & 0xF3;
             buffer |= ((mode & 0x03) << 2);
             setByte(this->ADDRESS_CONFIG, add, buffer);
+            unlock();
         }
     }
 
@@ -443,6 +1105,7 @@
     }
 
     void ST25DV::setI2CZoneLock(uint8_t area, uint8_t mode){
+        lock();
         uint8_t buffer = getByte(this->ADDRESS_CONFIG, this->REG_I2CSS);
         uint8_t newlock = mode & 0x03;
         switch (area){
@@ -461,6 +1124,7 @@
             default:
                 break;
         }
+        unlock();
     }
 
     bool ST25DV::getCCFileLock(uint8_t block){
@@ -488,7 +1152,7 @@
             setByte(this->ADDRESS_CONFIG, this->REG_MB_WDG, 0x00);
         }
         else{
-            setByte(this->ADDRESS_CONFIG, this-REG_MB_WDG, val);
+            setByte(this->ADDRESS_CONFIG, this->REG_MB_WDG, val);
         }
     }
 
@@ -524,7 +1188,7 @@
         return getByte(this->ADDRESS_CONFIG, this->REG_BLK_SIZE);
     }
 
-    uint8_t ST25DV::getSizeK(){
+    uint16_t ST25DV::getSizeK(){
         switch(getByte(this->ADDRESS_CONFIG, this->REG_MEM_SIZE_H)){
             case 0x07:
                 return 64;
@@ -543,6 +1207,8 @@
             return this->REG_USER_MEM_END_16K;
         case 64:
             return this->REG_USER_MEM_END_64K;
+        default:
+            return this->REG_USER_MEM_END_04K;
         }
     }
 
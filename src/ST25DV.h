@@ -18,6 +18,55 @@
 #include "arduino.h"
 #include <Wire.h>
 #include <stdint.h>
+#include "ST25DVCompress.h"
+
+//Build-wide flags: these configure ST25DV.cpp, so set them for the whole build
+//(compiler -D flags, build_flags, ...). Defining them in a sketch only does not
+//reach the library. The class layout is the same either way.
+//  ST25DV_THREADSAFE    when several tasks/threads share one tag, e.g. on ESP32
+//                       FreeRTOS or a Linux host
+//  ST25DV_TRACE_DEPTH   a power of two (e.g. 64) to record the last
+//                       ST25DV_TRACE_DEPTH bus transactions in a ring buffer
+struct ST25DVLockState;//Defined in ST25DV.cpp when ST25DV_THREADSAFE is set
+
+//Largest payload moved in one Wire transaction. 32 matches the Wire buffer
+//on the smallest cores, raise it on boards with bigger buffers.
+#ifndef ST25DV_I2C_CHUNK
+#define ST25DV_I2C_CHUNK 32
+#endif
+
+//Bus clock auto-tune: errors are counted per window of ST25DV_CLOCK_WINDOW
+//transactions. ST25DV_CLOCK_FALLBACK_ERRORS in one window drop the clock a step,
+//ST25DV_CLOCK_RECOVER_WINDOWS clean windows in a row raise it again, up to the
+//rate autoTuneClock() picked, if the autoTuneClock() reads pass at that rate.
+//Address NACKs (write cycle, RF session) are not counted.
+#ifndef ST25DV_CLOCK_WINDOW
+#define ST25DV_CLOCK_WINDOW 256
+#endif
+#ifndef ST25DV_CLOCK_FALLBACK_ERRORS
+#define ST25DV_CLOCK_FALLBACK_ERRORS 4
+#endif
+#ifndef ST25DV_CLOCK_RECOVER_WINDOWS
+#define ST25DV_CLOCK_RECOVER_WINDOWS 16
+#endif
+
+//Tag image format (see dumpImage/restoreImage)
+#define ST25DV_IMAGE_VERSION 1
+#define ST25DV_IMAGE_ERR_HEADER -1//Not an image or unknown version
+#define ST25DV_IMAGE_ERR_TAG -2//Image taken from a different IC type or memory size
+#define ST25DV_IMAGE_ERR_SHORT -3//Stream ended before the image did
+#define ST25DV_IMAGE_ERR_WRITE -4//The tag did not take a write (locked register/area, no security session)
+
+//Compressed record codecs (see writeSeries/writeCompressed)
+#define ST25DV_CODEC_DELTA 1//Delta + zig-zag varint int32_t series
+#define ST25DV_CODEC_LZ 2//Byte stream, 256 byte window LZ
+#define ST25DV_RECORD_HEADER 5
+
+//Transaction trace (see ST25DV_TRACE_DEPTH above)
+#define ST25DV_TRACE_VERSION 1
+#define ST25DV_TRACE_WRITE 0x80//Flag bit, the low nibble holds the Wire status
+#define ST25DV_TRACE_SHORT_READ 0x40//Flag bit, fewer bytes arrived than requested (Wire status was 0)
+#define ST25DV_TRACE_BATCH 8//Entries dumpTrace() copies per lock, kept on the stack
 
 typedef union
 {
@@ -25,38 +74,93 @@ typedef union
     uint8_t d8[8];
 }array64bits;
 
+typedef struct
+{
+    uint32_t time;//micros() when the transaction started
+    uint16_t duration;//Bus time in us, saturates at 0xFFFF, excludes EEPROM write delays
+    uint16_t reg;
+    uint16_t len;
+    uint8_t add;
+    uint8_t flags;
+}ST25DVTraceEntry;
+
 
 class ST25DV
 {
     public:
     //Constructors
         ST25DV(void);
-        uint8_t begin(TwoWire &port = Wire);
+        ~ST25DV(void);
+        ST25DV(const ST25DV&) = delete;
+        ST25DV& operator=(const ST25DV&) = delete;
+        uint8_t begin(TwoWire &port = Wire, bool autoClock = false);
         void enableDelay(bool en);
+
+    //Bus clock functions
+        uint32_t autoTuneClock();//Picks the fastest of 100k/400k/1M that reads back correctly
+        void setBusClock(uint32_t hz);//Fixed rate, disables runtime fallback
+        uint32_t getBusClock();
+        uint32_t getBusErrors();//Failed transactions since begin
+        uint16_t getClockErrors();//Failed transactions in the current window
+
+    //Bus arbitration (only active with ST25DV_THREADSAFE, no-ops otherwise)
+        void lock(bool priority = false);//Re-entrant, priority waiters go first
+        void unlock();
         
     
     //Worker functions
-        //uint8_t* getBulk(uint8_t add, uint16_t reg, uint8_t len);//TODO for later
-        //void setBulk(uint8_t add, uint16_t reg, uint8_t len, uint8_t* dat);//TODO for later
+        void getBulk(uint8_t add, uint16_t reg, uint16_t len, uint8_t* dat);
+        void setBulk(uint8_t add, uint16_t reg, uint16_t len, const uint8_t* dat);
         uint64_t get64bits(uint8_t add, uint16_t reg);
         void set64bits(uint8_t add, uint16_t reg, uint64_t dat);
         uint16_t get16bits(uint8_t add, uint16_t reg);
         void set16bits(uint8_t add, uint16_t reg, uint16_t dat);
         uint8_t getByte(uint8_t add, uint16_t reg);
         void setByte(uint8_t add, uint16_t reg, uint8_t dat);
-        bool getBit(uint8_t add, uint8_t reg, uint8_t bit);
-        void setBit(uint8_t add, uint8_t reg, uint8_t bit, bool dat);
+        bool getBit(uint8_t add, uint16_t reg, uint8_t bit);
+        void setBit(uint8_t add, uint16_t reg, uint8_t bit, bool dat);
         bool presentPassword(uint64_t pass);
 
 
+    //Transaction trace functions (record nothing unless ST25DV_TRACE_DEPTH is set)
+        //Dump layout, multi-byte fields little endian:
+        //  "S25T", version, entry size, depth (2), total recorded (4),
+        //  entries oldest first as time (4), duration (2), reg (2), len (2), add, flags
+        uint32_t dumpTrace(Print &out);//Returns bytes written to out
+        void clearTrace();
+
+
 
     //User memory functions
-        //uint8_t* read(uint16_t reg, uint8_t len);//TODO for later
-        //void write(uint16_t reg, uint8_t len, uint8_t* dat);//TODO for later
+        void read(uint16_t reg, uint16_t len, uint8_t* dat);
+        void write(uint16_t reg, uint16_t len, const uint8_t* dat);
         uint8_t readByte(uint16_t reg);
         void writeByte(uint16_t reg, uint8_t dat);
 
 
+    //Tag image functions
+        //Image layout, multi-byte fields little endian:
+        //  "ST25", version, ICRef, revision, size in K (2), UID (8), config length,
+        //  system config bytes from REG_GPO, user memory from REG_USER_MEM_START
+        uint32_t dumpImage(Print &out);//Returns bytes written to out
+        int32_t restoreImage(Stream &in);//Returns bytes rewritten and verified or ST25DV_IMAGE_ERR_*
+
+
+    //Compressed record functions
+        //Record layout, multi-byte fields little endian:
+        //  codec, raw count (2) in samples or bytes, payload length (2), payload
+        //A record that does not fit is rejected before anything is written. The header
+        //goes last, so an interrupted write never leaves a new header on a partial payload.
+        uint16_t writeSeries(uint16_t reg, const int32_t* samples, uint16_t count);//Returns record size, 0 if it does not fit
+        uint16_t writeCompressed(uint16_t reg, const uint8_t* dat, uint16_t len);//Returns record size, 0 if it does not fit
+        uint16_t readSeries(uint16_t reg, int32_t* samples, uint16_t maxCount);//Returns samples decoded
+        uint16_t readCompressed(uint16_t reg, uint8_t* dat, uint16_t maxLen);//Returns bytes decoded
+        uint32_t getRawBytes();//Uncompressed size of all records written
+        uint32_t getStoredBytes();//Bytes actually written for them, headers included
+        int32_t getBytesSaved();
+        float getCompressionRatio();//Raw / stored, 1.0 before any record is written
+
+
     //Dynamic register functions
         bool getGPOEnabledDyn();
         void setGPOEnabledDyn(bool val);
@@ -151,6 +255,36 @@ class ST25DV
         TwoWire *WIREPORT;
         uint16_t MEMENDPOINT;
         uint8_t BUILT_IN_DELAY;
+        bool isMailboxReg(uint8_t add, uint16_t reg);
+        void busResult(uint8_t flags);
+        bool probeClock(uint8_t index);
+        void applyClock(uint8_t index);
+        const uint32_t BUS_CLOCKS[3] = {100000, 400000, 1000000};//Standard, Fast, Fast-mode Plus
+        uint32_t BUS_CLOCK = 100000;//Assumed platform default until set
+        uint8_t CLOCK_INDEX = 0;
+        uint8_t TUNED_INDEX = 0;//Highest rate runtime recovery may return to
+        uint64_t REF_UID = 0;//Known values autoTuneClock() and recovery probe with
+        uint8_t REF_ICREF = 0;
+        uint16_t REF_BLOCKS = 0;
+        uint16_t WINDOW_TRANSACTIONS = 0;
+        uint8_t CLEAN_WINDOWS = 0;
+        bool AUTO_CLOCK = false;
+        uint32_t BUS_ERRORS = 0;
+        uint16_t CLOCK_ERRORS = 0;
+        uint32_t RAW_BYTES = 0;
+        uint32_t STORED_BYTES = 0;
+        bool recordFits(uint16_t reg, uint32_t len);
+        bool readRecordHeader(uint16_t reg, uint8_t codec, uint16_t &count, uint16_t &len);
+        const uint8_t PAGE_SIZE = 4;//EEPROM programming unit in bytes
+        static const uint8_t IMAGE_CONFIG_LEN = 0x14;//REG_GPO up to and including REG_AFI
+        static const uint8_t IMAGE_CONFIG_RW_LEN = 0x10;//REG_GPO up to and including REG_LOCK_CFG
+        bool restoreConfigByte(uint16_t reg, uint8_t dat, int32_t &written);
+        void restoreWait(uint16_t reg, uint16_t len);
+        ST25DVTraceEntry *TRACE = nullptr;//Only allocated with ST25DV_TRACE_DEPTH
+        uint32_t TRACE_COUNT = 0;//Total recorded, the ring index is the low bits
+        inline uint32_t traceStart();//Defined in ST25DV.cpp, only used there
+        inline void trace(uint8_t add, uint16_t reg, uint16_t len, uint8_t flags, uint32_t start);
+        ST25DVLockState *LOCK_STATE = nullptr;//Only allocated with ST25DV_THREADSAFE
         const uint8_t ADDRESS = 0x53;//For user memory, dynamic registers, FTM mailbox
         const uint8_t ADDRESS_CONFIG = 0x57;//For sytem config registers
 
@@ -0,0 +1,152 @@
+//============================================================================
+// Name        : ST25DVCompress.cpp
+// Description : Small streaming codecs used by the ST25DV compressed record
+//               functions. See ST25DVCompress.h for the encoded formats.
+//============================================================================
+
+#include "ST25DVCompress.h"
+#include <string.h>
+
+//Delta encoder
+    ST25DVDeltaEncoder::ST25DVDeltaEncoder(){
+        this->PREVIOUS = 0;
+    }
+
+    uint8_t ST25DVDeltaEncoder::push(int32_t sample, uint8_t* out){
+        int32_t delta = (uint32_t)sample - (uint32_t)this->PREVIOUS;//Wraps, the decoder wraps back
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        this->PREVIOUS = sample;
+        uint8_t count = 0;
+        while(zigzag > 0x7F){
+            out[count++] = (zigzag & 0x7F) | 0x80;
+            zigzag >>= 7;
+        }
+        out[count++] = zigzag;
+        return count;
+    }
+
+
+
+//Delta decoder
+    ST25DVDeltaDecoder::ST25DVDeltaDecoder(){
+        this->PREVIOUS = 0;
+        this->VALUE = 0;
+        this->SHIFT = 0;
+    }
+
+    //A varint never needs more than 5 bytes for 32 bits. Longer runs of
+    //continuation bytes come from corrupt data and are dropped.
+    bool ST25DVDeltaDecoder::push(uint8_t dat, int32_t &sample){
+        this->VALUE |= (uint32_t)(dat & 0x7F) << this->SHIFT;
+        if(dat & 0x80){
+            this->SHIFT += 7;
+            if(this->SHIFT > 28){
+                this->VALUE = 0;
+                this->SHIFT = 0;
+            }
+            return 0;
+        }
+        int32_t delta = (this->VALUE >> 1) ^ (0 - (this->VALUE & 0x01));
+        this->PREVIOUS = (uint32_t)this->PREVIOUS + (uint32_t)delta;
+        this->VALUE = 0;
+        this->SHIFT = 0;
+        sample = this->PREVIOUS;
+        return 1;
+    }
+
+
+
+//LZ encoder
+    uint8_t ST25DVLZEncoder::next(const uint8_t* in, uint16_t len, uint16_t &pos, uint8_t* out){
+        uint16_t distance;
+        uint8_t length = match(in, len, pos, distance);
+        if(length){
+            out[0] = 0x80 | (length - ST25DV_LZ_MIN_MATCH);
+            out[1] = distance - 1;
+            pos += length;
+            return 2;
+        }
+        //Literal run up to the next position that starts a match
+        uint8_t count = 0;
+        do{
+            out[1 + count] = in[pos + count];
+            count++;
+        }while((count < ST25DV_LZ_MAX_LITERALS) && (pos + count < len) && !match(in, len, pos + count, distance));
+        out[0] = count - 1;
+        pos += count;
+        return count + 1;
+    }
+
+    //Longest match for in[pos..] within the window, 0 if shorter than ST25DV_LZ_MIN_MATCH.
+    //Matches may overlap pos, which encodes runs as a distance 1 match.
+    uint8_t ST25DVLZEncoder::match(const uint8_t* in, uint16_t len, uint16_t pos, uint16_t &distance){
+        uint16_t limit = (len - pos < ST25DV_LZ_MAX_MATCH) ? len - pos : ST25DV_LZ_MAX_MATCH;
+        uint16_t window = (pos < ST25DV_LZ_WINDOW) ? pos : ST25DV_LZ_WINDOW;
+        uint8_t best = 0;
+        for(uint16_t d = 1; (d <= window) && (best < limit); d++){
+            uint8_t length = 0;
+            while((length < limit) && (in[pos - d + length] == in[pos + length])){
+                length++;
+            }
+            if(length > best){
+                best = length;
+                distance = d;
+            }
+        }
+        return (best >= ST25DV_LZ_MIN_MATCH) ? best : 0;
+    }
+
+
+
+//LZ decoder
+    ST25DVLZDecoder::ST25DVLZDecoder(){
+        memset(this->HISTORY, 0, sizeof(this->HISTORY));//Bad distances read zeros, not stale RAM
+        this->HEAD = 0;
+        this->LITERALS = 0;
+        this->COPY = 0;
+        this->DISTANCE = 0;
+        this->WANT_DISTANCE = 0;
+        this->HAVE_LITERAL = 0;
+        this->LITERAL = 0;
+    }
+
+    bool ST25DVLZDecoder::needInput(){
+        return !available();
+    }
+
+    void ST25DVLZDecoder::push(uint8_t dat){
+        if(this->WANT_DISTANCE){
+            this->DISTANCE = dat;
+            this->WANT_DISTANCE = 0;
+        }
+        else if(this->LITERALS){
+            this->LITERAL = dat;
+            this->HAVE_LITERAL = 1;
+            this->LITERALS--;
+        }
+        else if(dat & 0x80){
+            this->COPY = (dat & 0x7F) + ST25DV_LZ_MIN_MATCH;
+            this->WANT_DISTANCE = 1;
+        }
+        else{
+            this->LITERALS = dat + 1;
+        }
+    }
+
+    bool ST25DVLZDecoder::available(){
+        return this->HAVE_LITERAL || (this->COPY && !this->WANT_DISTANCE);
+    }
+
+    uint8_t ST25DVLZDecoder::read(){
+        uint8_t dat;
+        if(this->HAVE_LITERAL){
+            dat = this->LITERAL;
+            this->HAVE_LITERAL = 0;
+        }
+        else{
+            dat = this->HISTORY[(uint8_t)(this->HEAD - this->DISTANCE - 1)];
+            this->COPY--;
+        }
+        this->HISTORY[this->HEAD++] = dat;
+        return dat;
+    }
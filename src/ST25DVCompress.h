@@ -0,0 +1,84 @@
+//============================================================================
+// Name        : ST25DVCompress.h
+// Description : Small streaming codecs used by the ST25DV compressed record
+//               functions. Both decoders take one encoded byte at a time so
+//               records can be read straight off the tag (or by a phone)
+//               without buffering the whole payload.
+//
+//               Delta: first sample, then the difference to the previous one,
+//               each zig-zag mapped and written as a little endian base-128
+//               varint (7 bits per byte, high bit set on all but the last).
+//
+//               LZ: a token byte with the high bit clear starts a run of
+//               (token + 1) literal bytes. With the high bit set it is a match
+//               of ((token & 0x7F) + ST25DV_LZ_MIN_MATCH) bytes copied from
+//               (next byte + 1) bytes back in the decoded output.
+//============================================================================
+
+#ifndef ST25DVCompress_h
+#define ST25DVCompress_h
+
+#include <stdint.h>
+
+#define ST25DV_LZ_WINDOW 256//Match distance limit and decoder RAM use, fixed by the format
+#define ST25DV_LZ_MIN_MATCH 3
+#define ST25DV_LZ_MAX_MATCH (0x7F + ST25DV_LZ_MIN_MATCH)
+#define ST25DV_LZ_MAX_LITERALS 0x80
+
+
+class ST25DVDeltaEncoder
+{
+    public:
+        ST25DVDeltaEncoder(void);
+        uint8_t push(int32_t sample, uint8_t* out);//Writes up to 5 bytes, returns count
+
+    private:
+        int32_t PREVIOUS;
+};
+
+
+class ST25DVDeltaDecoder
+{
+    public:
+        ST25DVDeltaDecoder(void);
+        bool push(uint8_t dat, int32_t &sample);//True once a sample is complete
+
+    private:
+        int32_t PREVIOUS;
+        uint32_t VALUE;
+        uint8_t SHIFT;
+};
+
+
+class ST25DVLZEncoder
+{
+    public:
+        //Encodes the next token of in[pos..len) into out (at most
+        //ST25DV_LZ_MAX_LITERALS + 1 bytes), advances pos and returns the bytes written
+        static uint8_t next(const uint8_t* in, uint16_t len, uint16_t &pos, uint8_t* out);
+
+    private:
+        static uint8_t match(const uint8_t* in, uint16_t len, uint16_t pos, uint16_t &distance);
+};
+
+
+class ST25DVLZDecoder
+{
+    public:
+        ST25DVLZDecoder(void);
+        bool needInput();//True when push() may be called
+        void push(uint8_t dat);
+        bool available();//True when read() has a decoded byte
+        uint8_t read();
+
+    private:
+        uint8_t HISTORY[ST25DV_LZ_WINDOW];
+        uint8_t HEAD;//Next write position in HISTORY, wraps with the uint8_t
+        uint8_t LITERALS;//Literal bytes still to come from the input
+        uint8_t COPY;//Match bytes still to come from HISTORY
+        uint8_t DISTANCE;
+        bool WANT_DISTANCE;
+        bool HAVE_LITERAL;
+        uint8_t LITERAL;
+};
+#endif